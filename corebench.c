@@ -0,0 +1,166 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Zygmunt Krynicki
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <mqueue.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "errslot.h"
+#include "mqparse.h"
+#include "strlist.h"
+
+// corebench times the library pieces used by mqctl without touching any
+// message queue. Each benchmark runs for several rounds and reports the
+// fastest round, which is the figure least affected by unrelated system noise.
+
+#define COREBENCH_ROUNDS 7
+
+static volatile int corebench_sink;
+static FILE *corebench_devnull;
+
+static int visit_count(void *data, const char *item, size_t item_len)
+{
+    (void)item;
+    *(size_t *)data += item_len;
+    return 0;
+}
+
+static void bench_strlist_short(long n)
+{
+    for (long i = 0; i < n; i++)
+    {
+        size_t total = 0;
+        strlist_each("read-write,nonblock", ',', visit_count, &total);
+        corebench_sink += (int)total;
+    }
+}
+
+static void bench_strlist_long(long n)
+{
+    static const char list[] = "read-only,write-only,read-write,create,excl,nonblock,read-only,write-only,"
+                               "read-write,create,excl,nonblock,read-only,write-only,read-write,create,"
+                               "excl,nonblock,read-only,write-only,read-write,create,excl,nonblock";
+    for (long i = 0; i < n; i++)
+    {
+        size_t total = 0;
+        strlist_each(list, ',', visit_count, &total);
+        corebench_sink += (int)total;
+    }
+}
+
+static void bench_visit_open_flag(long n)
+{
+    for (long i = 0; i < n; i++)
+    {
+        int flag = 0;
+        strlist_each("read-write,excl,nonblock", ',', visit_open_flag, &flag);
+        corebench_sink += flag;
+    }
+}
+
+static void bench_visit_mq_attr(long n)
+{
+    for (long i = 0; i < n; i++)
+    {
+        struct mq_attr attr = {0};
+        strlist_each("max-size=1024,max-count=10", ',', visit_mq_attr, &attr);
+        corebench_sink += (int)attr.mq_maxmsg;
+    }
+}
+
+static void bench_errslot_cycle(long n)
+{
+    for (long i = 0; i < n; i++)
+    {
+        errslot_index_t err = errslot_plain("benchmark error");
+        corebench_sink += err;
+        errslot_unref(err);
+    }
+}
+
+static void bench_errslot_nested_cycle(long n)
+{
+    for (long i = 0; i < n; i++)
+    {
+        errno = EACCES;
+        errslot_index_t err = errslot_errno("mq_open failed");
+        err = errslot_plain_cause("cannot parse open flag list", err);
+        err = errslot_plain_cause("cannot parse arguments", err);
+        corebench_sink += err;
+        errslot_unref(err);
+    }
+}
+
+static void bench_errslot_print_nested(long n)
+{
+    for (long i = 0; i < n; i++)
+    {
+        errno = EACCES;
+        errslot_index_t err = errslot_errno("mq_open failed");
+        err = errslot_plain_cause("cannot parse open flag list", err);
+        err = errslot_plain_cause("cannot parse arguments", err);
+        corebench_sink += errslot_print(corebench_devnull, err);
+        errslot_unref(err);
+    }
+}
+
+struct corebench
+{
+    const char *cb_name;
+    void (*cb_func)(long n);
+    long cb_iterations;
+};
+
+static const struct corebench corebench_list[] = {
+    {"strlist_each/short", bench_strlist_short, 1000000},
+    {"strlist_each/long", bench_strlist_long, 100000},
+    {"visit_open_flag", bench_visit_open_flag, 1000000},
+    {"visit_mq_attr", bench_visit_mq_attr, 200000},
+    {"errslot_make+unref", bench_errslot_cycle, 1000000},
+    {"errslot_make+unref/nested", bench_errslot_nested_cycle, 300000},
+    {"errslot_print/nested", bench_errslot_print_nested, 100000},
+};
+
+static double elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 + (double)(end->tv_nsec - start->tv_nsec);
+}
+
+int main(void)
+{
+    corebench_devnull = fopen("/dev/null", "w");
+    if (corebench_devnull == NULL)
+    {
+        perror("cannot open /dev/null");
+        return 1;
+    }
+
+    for (size_t i = 0; i < sizeof corebench_list / sizeof corebench_list[0]; i++)
+    {
+        const struct corebench *bench = &corebench_list[i];
+        double best = 0;
+
+        // Warm up caches and branch predictors before measuring.
+        bench->cb_func(bench->cb_iterations / 10);
+        for (int round = 0; round < COREBENCH_ROUNDS; round++)
+        {
+            struct timespec start, end;
+            (void)clock_gettime(CLOCK_MONOTONIC, &start);
+            bench->cb_func(bench->cb_iterations);
+            (void)clock_gettime(CLOCK_MONOTONIC, &end);
+            double per_op = elapsed_ns(&start, &end) / (double)bench->cb_iterations;
+            if (round == 0 || per_op < best)
+                best = per_op;
+        }
+        printf("name=%s ns_per_op=%.2f iterations=%ld rounds=%d\n", bench->cb_name, best, bench->cb_iterations,
+               COREBENCH_ROUNDS);
+    }
+
+    fclose(corebench_devnull);
+    return 0;
+}
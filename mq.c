@@ -1,67 +1,23 @@
 // SPDX-License-Identifier: Apache-2.0
 // SPDX-FileCopyrightText: Zygmunt Krynicki
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <fcntl.h>
 #include <mqueue.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/param.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "errslot.h"
+#include "mqparse.h"
+#include "output.h"
 #include "strlist.h"
 
-static int visit_open_flag(void *data, const char *item, size_t item_len)
-{
-    int *flag = data;
-
-    if (strncmp(item, "read-only", item_len) == 0)
-    {
-        *flag &= ~O_RDWR;
-        *flag |= O_RDONLY;
-    }
-    else if (strncmp(item, "write-only", item_len) == 0)
-    {
-        *flag &= ~O_RDWR;
-        *flag |= O_WRONLY;
-    }
-    else if (strncmp(item, "read-write", item_len) == 0)
-        *flag |= O_RDWR;
-    else if (strncmp(item, "create", item_len) == 0)
-        *flag |= O_CREAT;
-    else if (strncmp(item, "excl", item_len) == 0)
-        *flag |= O_EXCL;
-    else if (strncmp(item, "nonblock", item_len) == 0)
-        *flag |= O_NONBLOCK;
-    else
-        return errslot_plain("unknown open flag, expected one of: read-only, write-only, read-write, excl or nonblock");
-
-    return 0;
-}
-
-static errslot_index_t visit_mq_attr(void *data, const char *item, size_t item_len)
-{
-    struct mq_attr *attr = data;
-
-    if (strncmp(item, "max-size=", MIN(item_len, strlen("max-size="))) == 0)
-    {
-        if (sscanf(item + strlen("max-size="), "%ld", &attr->mq_msgsize) != 1)
-            return errslot_plain("cannot parse maximum message size");
-    }
-    else if (strncmp(item, "max-count=", MIN(item_len, strlen("max-count="))) == 0)
-    {
-        if (sscanf(item + strlen("max-count="), "%ld", &attr->mq_maxmsg) != 1)
-            return errslot_plain("cannot parse maximum message count");
-    }
-    else
-        return errslot_plain("unrecognized attribute, expected one of max-size=N or max-count=N");
-
-    return 0;
-}
-
 struct cmd_open_args
 {
     const char *name;
@@ -317,37 +273,148 @@ static errslot_index_t cmd_notify(int argc, char **argv)
     return 0;
 }
 
+static errslot_index_t parse_output_option(int *argcp, char ***argvp)
+{
+    if (*argcp == 0 || strncmp(*argvp[0], "--output=", strlen("--output=")) != 0)
+        return 0;
+    const char *opt = consume_arg(argcp, argvp);
+    enum output_mode mode;
+    errslot_index_t err = output_parse_mode(opt + strlen("--output="), &mode);
+    if (err < 0)
+        return err;
+    output_set_mode(mode);
+    return 0;
+}
+
+// Largest message size the kernel allows, HARD_MSGSIZEMAX in the kernel sources. Untouched pages
+// of the receive buffer are never faulted in, so only the size of actual messages is paid for.
+#define CMD_RECV_BUF_SIZE (16 * 1024 * 1024)
+
+static volatile sig_atomic_t cmd_recv_stop;
+
+static void cmd_recv_stop_action(__attribute__((unused)) int signum)
+{
+    cmd_recv_stop = 1;
+}
+
+// cmd_recv_one receives one message, failing with EINTR once a stop signal was delivered.
+static ssize_t cmd_recv_one(mqd_t mqd, char *buf, size_t buf_size, unsigned int *prio)
+{
+    if (output_get_mode() == OUTPUT_TEXT)
+        return mq_receive(mqd, buf, buf_size, prio);
+
+    for (;;)
+    {
+        if (cmd_recv_stop)
+        {
+            errno = EINTR;
+            return -1;
+        }
+        // Wake up in time to flush buffered output even if no further messages arrive, and
+        // periodically otherwise to notice a stop signal delivered just before the call.
+        struct timespec deadline;
+        output_flush_deadline(&deadline);
+        ssize_t len = mq_timedreceive(mqd, buf, buf_size, prio, &deadline);
+        if (len != -1 || (errno != ETIMEDOUT && errno != EINTR))
+            return len;
+        if (errno == ETIMEDOUT && output_flush() < 0)
+            return -1;
+    }
+}
+
+static errslot_index_t cmd_recv_install_stop_handlers(void)
+{
+    // Without SA_RESTART a blocked receive returns EINTR so buffered output can be flushed.
+    // SA_RESETHAND lets a second signal terminate the process as usual.
+    struct sigaction act = {
+        .sa_flags = SA_RESETHAND,
+        .sa_handler = cmd_recv_stop_action,
+    };
+    if (sigaction(SIGINT, &act, NULL) < 0 || sigaction(SIGTERM, &act, NULL) < 0 ||
+        sigaction(SIGHUP, &act, NULL) < 0)
+        return errslot_errno("sigaction failed");
+    return 0;
+}
+
 static errslot_index_t cmd_recv(int argc, char **argv)
 {
     if (argc == 0)
-        return errslot_plain("usage: mqctl recv NAME OPEN-FLAG-LIST");
+        return errslot_plain("usage: mqctl recv [--output=text|raw|lenprefixed|ndjson] NAME OPEN-FLAG-LIST [COUNT]");
 
+    errslot_index_t err = parse_output_option(&argc, &argv);
+    if (err < 0)
+        return errslot_plain_cause("cannot parse arguments", err);
     struct cmd_open_args args;
-    errslot_index_t err = parse_open_args(&args, &argc, &argv);
+    err = parse_open_args(&args, &argc, &argv);
     if (err < 0)
         return errslot_plain_cause("cannot parse arguments", err);
     if (args.flag & O_CREAT)
         return errslot_plain("Use the create command to create a message queue");
+    // COUNT of zero receives until the queue is drained, or forever in blocking mode.
+    unsigned long count = 1;
+    if (argc > 0)
+    {
+        const char *count_str = consume_arg(&argc, &argv);
+        if (sscanf(count_str, "%lu", &count) != 1)
+            return errslot_plain("cannot parse message count");
+    }
     if (argc > 0)
         return errslot_plain("too many arguments");
 
+    // Human readable status is only written in text mode, other modes carry just the messages.
+    int text = output_get_mode() == OUTPUT_TEXT;
+    if (!text)
+    {
+        err = cmd_recv_install_stop_handlers();
+        if (err < 0)
+            return err;
+    }
+
     mqd_t mqd = mq_open(args.name, args.flag);
     if (mqd == (mqd_t)-1)
         return errslot_errno("mq_open failed");
-    printf("mq_open did not fail\n");
+    if (text)
+        printf("mq_open did not fail\n");
 
-    char buf[1024];
-    unsigned int prio = 0;
-    ssize_t len = mq_receive(mqd, buf, sizeof(buf), &prio);
-    if (len == -1)
-        return errslot_errno("mq_receive failed");
-    printf("mq_receive did not fail\n");
+    // The buffer is not sized with mq_getattr so that recv needs only open and read permissions.
+    char *buf = malloc(CMD_RECV_BUF_SIZE);
+    if (buf == NULL)
+        return errslot_errno("cannot allocate message buffer");
+
+    for (unsigned long i = 0; count == 0 || i < count; i++)
+    {
+        unsigned int prio = 0;
+        ssize_t len = cmd_recv_one(mqd, buf, CMD_RECV_BUF_SIZE, &prio);
+        if (len == -1 && errno == EAGAIN && count == 0)
+            break;
+        // A stop signal ends the loop normally so that received messages are flushed.
+        if (len == -1 && errno == EINTR && cmd_recv_stop)
+            break;
+        if (len == -1)
+        {
+            err = errslot_errno("mq_receive failed");
+            free(buf);
+            return err;
+        }
+        if (text)
+            printf("mq_receive did not fail\n");
+
+        if (output_message(prio, buf, len) < 0)
+        {
+            err = errslot_errno("cannot write message");
+            free(buf);
+            return err;
+        }
+    }
+    free(buf);
 
-    printf("Received message with priority %u: %.*s\n", prio, (int)len, buf);
+    if (output_flush() < 0)
+        return errslot_errno("cannot write message");
 
     if (mq_close(mqd) == -1)
         return errslot_errno("mq_close failed");
-    printf("mq_close did not fail\n");
+    if (text)
+        printf("mq_close did not fail\n");
 
     return 0;
 }
@@ -415,11 +482,178 @@ static errslot_index_t cmd_unlink(int argc, char **argv)
     return 0;
 }
 
+// Size of messages in the queue created by the probe.
+#define PROBE_MSGSIZE 64
+
+struct probe_state
+{
+    const char *name;
+    // Set once the probe created the queue, unlink is skipped otherwise.
+    int created;
+    mqd_t mqd_create;
+    mqd_t mqd_read;
+    mqd_t mqd_write;
+    // Set once a message was sent, recv is skipped otherwise as the queue is empty.
+    int sent;
+    char recv_buf[PROBE_MSGSIZE];
+};
+
+// Each probe step returns 0 on success or -1 with errno set. Steps that depend on a
+// descriptor that could not be opened return 1 to indicate they were skipped.
+struct probe_step
+{
+    const char *ps_name;
+    int (*ps_func)(struct probe_state *state);
+};
+
+static int probe_create(struct probe_state *state)
+{
+    // O_EXCL ensures that the remaining steps only ever see the queue created here.
+    struct mq_attr attr = {.mq_maxmsg = 1, .mq_msgsize = PROBE_MSGSIZE};
+    state->mqd_create = mq_open(state->name, O_RDONLY | O_CREAT | O_EXCL | O_NONBLOCK, 0600, &attr);
+    if (state->mqd_create == (mqd_t)-1)
+        return -1;
+    state->created = 1;
+    return 0;
+}
+
+static int probe_open_read(struct probe_state *state)
+{
+    state->mqd_read = mq_open(state->name, O_RDONLY | O_NONBLOCK);
+    return state->mqd_read == (mqd_t)-1 ? -1 : 0;
+}
+
+static int probe_open_write(struct probe_state *state)
+{
+    state->mqd_write = mq_open(state->name, O_WRONLY | O_NONBLOCK);
+    return state->mqd_write == (mqd_t)-1 ? -1 : 0;
+}
+
+static mqd_t probe_any_mqd(const struct probe_state *state)
+{
+    return state->mqd_read != (mqd_t)-1 ? state->mqd_read : state->mqd_write;
+}
+
+static int probe_getattr(struct probe_state *state)
+{
+    mqd_t mqd = probe_any_mqd(state);
+    if (mqd == (mqd_t)-1)
+        return 1;
+    struct mq_attr attr;
+    return mq_getattr(mqd, &attr);
+}
+
+static int probe_setattr(struct probe_state *state)
+{
+    mqd_t mqd = probe_any_mqd(state);
+    if (mqd == (mqd_t)-1)
+        return 1;
+    // Keep the descriptor non-blocking so that later steps cannot hang.
+    struct mq_attr attr = {.mq_flags = O_NONBLOCK};
+    return mq_setattr(mqd, &attr, NULL);
+}
+
+static int probe_send(struct probe_state *state)
+{
+    if (state->mqd_write == (mqd_t)-1)
+        return 1;
+    if (mq_send(state->mqd_write, "probe", strlen("probe"), 0) == -1)
+        return -1;
+    state->sent = 1;
+    return 0;
+}
+
+static int probe_recv(struct probe_state *state)
+{
+    if (state->mqd_read == (mqd_t)-1 || !state->sent)
+        return 1;
+    return mq_receive(state->mqd_read, state->recv_buf, sizeof state->recv_buf, NULL) == -1 ? -1 : 0;
+}
+
+static int probe_notify(struct probe_state *state)
+{
+    mqd_t mqd = probe_any_mqd(state);
+    if (mqd == (mqd_t)-1)
+        return 1;
+    // SIGEV_NONE registers for notification without ever delivering one.
+    struct sigevent sev = {.sigev_notify = SIGEV_NONE};
+    if (mq_notify(mqd, &sev) == -1)
+        return -1;
+    (void)mq_notify(mqd, NULL);
+    return 0;
+}
+
+static int probe_unlink(struct probe_state *state)
+{
+    if (!state->created)
+        return 1;
+    return mq_unlink(state->name);
+}
+
+static const struct probe_step probe_steps[] = {
+    {"create", probe_create},   {"open-read", probe_open_read}, {"open-write", probe_open_write},
+    {"getattr", probe_getattr}, {"setattr", probe_setattr},     {"send", probe_send},
+    {"recv", probe_recv},       {"notify", probe_notify},       {"unlink", probe_unlink},
+};
+
+static long long probe_elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+    return (long long)(end->tv_sec - start->tv_sec) * 1000000000LL + (end->tv_nsec - start->tv_nsec);
+}
+
+static errslot_index_t cmd_probe(int argc, char **argv)
+{
+    if (argc == 0)
+        return errslot_plain("usage: mqctl probe NAME");
+    struct probe_state state = {.mqd_create = (mqd_t)-1, .mqd_read = (mqd_t)-1, .mqd_write = (mqd_t)-1};
+    errslot_index_t err = parse_queue_name(&state.name, &argc, &argv);
+    if (err < 0)
+        return err;
+    if (argc > 0)
+        return errslot_plain("too many arguments");
+
+    printf("%-10s %-8s %5s %10s\n", "STEP", "RESULT", "ERRNO", "TIME-NS");
+    for (size_t i = 0; i < sizeof probe_steps / sizeof probe_steps[0]; i++)
+    {
+        const struct probe_step *step = &probe_steps[i];
+        struct timespec start, end;
+
+        errno = 0;
+        (void)clock_gettime(CLOCK_MONOTONIC, &start);
+        int ret = step->ps_func(&state);
+        int saved_errno = errno;
+        (void)clock_gettime(CLOCK_MONOTONIC, &end);
+
+        if (ret > 0)
+            printf("%-10s %-8s %5s %10s\n", step->ps_name, "skipped", "-", "-");
+        else if (ret == 0)
+            printf("%-10s %-8s %5d %10lld\n", step->ps_name, "allowed", 0, probe_elapsed_ns(&start, &end));
+        else
+            printf("%-10s %-8s %5d %10lld %s\n", step->ps_name,
+                   saved_errno == EACCES || saved_errno == EPERM ? "denied" : "failed", saved_errno,
+                   probe_elapsed_ns(&start, &end), strerror(saved_errno));
+
+        // Probing a queue that already exists would report results for, and then unlink, someone else's queue.
+        if (step->ps_func == probe_create && ret < 0 && saved_errno == EEXIST)
+            return errslot_plain("queue already exists, refusing to probe it");
+    }
+
+    // Descriptors are closed outside of the timed steps, unlink does not need them.
+    if (state.mqd_create != (mqd_t)-1)
+        (void)mq_close(state.mqd_create);
+    if (state.mqd_read != (mqd_t)-1)
+        (void)mq_close(state.mqd_read);
+    if (state.mqd_write != (mqd_t)-1)
+        (void)mq_close(state.mqd_write);
+
+    return 0;
+}
+
 static errslot_index_t errslot_main(int argc, char **argv)
 {
     (void)consume_arg(&argc, &argv); // Eat program name.
     if (argc == 0)
-        return errslot_plain("usage: mqctl {create,open,recv,send,notify,getattr,setattr,unlink} ...");
+        return errslot_plain("usage: mqctl {create,open,recv,send,notify,getattr,setattr,unlink,probe} ...");
     const char *cmd = consume_arg(&argc, &argv);
 
     if (strcmp(cmd, "open") == 0)
@@ -438,6 +672,8 @@ static errslot_index_t errslot_main(int argc, char **argv)
         return cmd_setattr(argc, argv);
     else if (strcmp(cmd, "unlink") == 0)
         return cmd_unlink(argc, argv);
+    else if (strcmp(cmd, "probe") == 0)
+        return cmd_probe(argc, argv);
     else
         return errslot_plain("unknown command");
 }
@@ -0,0 +1,60 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Zygmunt Krynicki
+
+#include "mqparse.h"
+
+#include <fcntl.h>
+#include <mqueue.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "errslot.h"
+
+int visit_open_flag(void *data, const char *item, size_t item_len)
+{
+    int *flag = data;
+
+    if (strncmp(item, "read-only", item_len) == 0)
+    {
+        *flag &= ~O_RDWR;
+        *flag |= O_RDONLY;
+    }
+    else if (strncmp(item, "write-only", item_len) == 0)
+    {
+        *flag &= ~O_RDWR;
+        *flag |= O_WRONLY;
+    }
+    else if (strncmp(item, "read-write", item_len) == 0)
+        *flag |= O_RDWR;
+    else if (strncmp(item, "create", item_len) == 0)
+        *flag |= O_CREAT;
+    else if (strncmp(item, "excl", item_len) == 0)
+        *flag |= O_EXCL;
+    else if (strncmp(item, "nonblock", item_len) == 0)
+        *flag |= O_NONBLOCK;
+    else
+        return errslot_plain("unknown open flag, expected one of: read-only, write-only, read-write, excl or nonblock");
+
+    return 0;
+}
+
+errslot_index_t visit_mq_attr(void *data, const char *item, size_t item_len)
+{
+    struct mq_attr *attr = data;
+
+    if (strncmp(item, "max-size=", MIN(item_len, strlen("max-size="))) == 0)
+    {
+        if (sscanf(item + strlen("max-size="), "%ld", &attr->mq_msgsize) != 1)
+            return errslot_plain("cannot parse maximum message size");
+    }
+    else if (strncmp(item, "max-count=", MIN(item_len, strlen("max-count="))) == 0)
+    {
+        if (sscanf(item + strlen("max-count="), "%ld", &attr->mq_maxmsg) != 1)
+            return errslot_plain("cannot parse maximum message count");
+    }
+    else
+        return errslot_plain("unrecognized attribute, expected one of max-size=N or max-count=N");
+
+    return 0;
+}
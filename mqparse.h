@@ -0,0 +1,13 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Zygmunt Krynicki
+
+#pragma once
+
+#include <stddef.h>
+
+#include "errslot.h"
+
+// visit_open_flag is a strlist_each visitor updating the int open flag pointed to by data.
+int visit_open_flag(void *data, const char *item, size_t item_len);
+// visit_mq_attr is a strlist_each visitor updating the struct mq_attr pointed to by data.
+errslot_index_t visit_mq_attr(void *data, const char *item, size_t item_len);
@@ -0,0 +1,197 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Zygmunt Krynicki
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "output.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <unistd.h>
+
+#define OUTPUT_BUF_SIZE (64 * 1024)
+
+static enum output_mode output_mode = OUTPUT_TEXT;
+static char output_buf[OUTPUT_BUF_SIZE];
+static size_t output_buf_len;
+// CLOCK_MONOTONIC time at which the oldest buffered byte was appended.
+static struct timespec output_pending_since;
+
+errslot_index_t output_parse_mode(const char *str, enum output_mode *mode)
+{
+    if (strcmp(str, "text") == 0)
+        *mode = OUTPUT_TEXT;
+    else if (strcmp(str, "raw") == 0)
+        *mode = OUTPUT_RAW;
+    else if (strcmp(str, "lenprefixed") == 0)
+        *mode = OUTPUT_LENPREFIXED;
+    else if (strcmp(str, "ndjson") == 0)
+        *mode = OUTPUT_NDJSON;
+    else
+        return errslot_plain("unknown output mode, expected one of: text, raw, lenprefixed or ndjson");
+    return 0;
+}
+
+static void output_flush_at_exit(void)
+{
+    (void)output_flush();
+}
+
+void output_set_mode(enum output_mode mode)
+{
+    static int registered;
+    output_mode = mode;
+    if (!registered && mode != OUTPUT_TEXT)
+    {
+        registered = 1;
+        (void)atexit(output_flush_at_exit);
+    }
+}
+
+enum output_mode output_get_mode(void)
+{
+    return output_mode;
+}
+
+int output_flush(void)
+{
+    size_t off = 0;
+    while (off < output_buf_len)
+    {
+        ssize_t n = write(STDOUT_FILENO, output_buf + off, output_buf_len - off);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            // Drop the rest, retrying later would repeat what was already written.
+            int saved_errno = errno;
+            output_buf_len = 0;
+            errno = saved_errno;
+            return -1;
+        }
+        off += n;
+    }
+
+    output_buf_len = 0;
+    return 0;
+}
+
+static int output_append(const void *data, size_t len)
+{
+    while (len > 0)
+    {
+        if (output_buf_len == sizeof output_buf && output_flush() < 0)
+            return -1;
+        if (output_buf_len == 0)
+            (void)clock_gettime(CLOCK_MONOTONIC, &output_pending_since);
+        size_t n = MIN(len, sizeof output_buf - output_buf_len);
+        memcpy(output_buf + output_buf_len, data, n);
+        output_buf_len += n;
+        data = (const char *)data + n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int output_append_u32be(uint32_t value)
+{
+    unsigned char bytes[4] = {value >> 24, value >> 16, value >> 8, value};
+    return output_append(bytes, sizeof bytes);
+}
+
+// output_append_json_string escapes data so that every byte survives the round trip.
+// Bytes outside printable ASCII are written as \u00XX, decode the string as Latin-1 to recover them.
+static int output_append_json_string(const char *data, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    if (output_append("\"", 1) < 0)
+        return -1;
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char c = data[i];
+        char esc[6];
+        size_t esc_len;
+        if (c == '"' || c == '\\')
+        {
+            esc[0] = '\\';
+            esc[1] = c;
+            esc_len = 2;
+        }
+        else if (c < 0x20 || c >= 0x7f)
+        {
+            memcpy(esc, "\\u00", 4);
+            esc[4] = hex[c >> 4];
+            esc[5] = hex[c & 0xf];
+            esc_len = 6;
+        }
+        else
+        {
+            esc[0] = c;
+            esc_len = 1;
+        }
+        if (output_append(esc, esc_len) < 0)
+            return -1;
+    }
+    return output_append("\"", 1);
+}
+
+// output_pending_ns returns how long the oldest buffered byte has been waiting.
+static long long output_pending_ns(void)
+{
+    struct timespec now;
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)(now.tv_sec - output_pending_since.tv_sec) * 1000000000LL +
+           (now.tv_nsec - output_pending_since.tv_nsec);
+}
+
+int output_message(unsigned int prio, const char *data, size_t len)
+{
+    switch (output_mode)
+    {
+    case OUTPUT_TEXT:
+        if (printf("Received message with priority %u: %.*s\n", prio, (int)len, data) < 0)
+            return -1;
+        return 0;
+    case OUTPUT_LENPREFIXED:
+        if (output_append_u32be(len) < 0 || output_append_u32be(prio) < 0)
+            return -1;
+        // fall through
+    case OUTPUT_RAW:
+        if (output_append(data, len) < 0)
+            return -1;
+        break;
+    case OUTPUT_NDJSON: {
+        char head[64];
+        int n = snprintf(head, sizeof head, "{\"priority\":%u,\"size\":%zu,\"data\":", prio, len);
+        if (output_append(head, n) < 0 || output_append_json_string(data, len) < 0 || output_append("}\n", 2) < 0)
+            return -1;
+        break;
+    }
+    }
+
+    if (output_buf_len > 0 && output_pending_ns() >= OUTPUT_FLUSH_INTERVAL_MS * 1000000LL)
+        return output_flush();
+    return 0;
+}
+
+void output_flush_deadline(struct timespec *deadline)
+{
+    // mq_timedreceive takes a CLOCK_REALTIME deadline, offset it by the remaining monotonic wait.
+    long long remaining_ns = OUTPUT_FLUSH_INTERVAL_MS * 1000000LL;
+    if (output_buf_len > 0)
+        remaining_ns -= output_pending_ns();
+    if (remaining_ns < 0)
+        remaining_ns = 0;
+    (void)clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += remaining_ns / 1000000000LL;
+    deadline->tv_nsec += remaining_ns % 1000000000LL;
+    if (deadline->tv_nsec >= 1000000000L)
+    {
+        deadline->tv_sec += deadline->tv_nsec / 1000000000L;
+        deadline->tv_nsec %= 1000000000L;
+    }
+}
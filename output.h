@@ -0,0 +1,38 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Zygmunt Krynicki
+
+#pragma once
+
+#include <stddef.h>
+#include <time.h>
+
+#include "errslot.h"
+
+enum output_mode
+{
+    // Human readable text written with printf, the default.
+    OUTPUT_TEXT,
+    // Message payloads written back to back without any framing.
+    OUTPUT_RAW,
+    // Each message is preceded by its length and priority as 32bit big-endian integers.
+    OUTPUT_LENPREFIXED,
+    // Each message is a JSON object on a line of its own.
+    OUTPUT_NDJSON,
+};
+
+// output_parse_mode parses one of text, raw, lenprefixed or ndjson.
+errslot_index_t output_parse_mode(const char *str, enum output_mode *mode);
+// output_set_mode selects the output mode and arranges for output_flush to run at exit.
+void output_set_mode(enum output_mode mode);
+// output_get_mode returns the selected output mode.
+enum output_mode output_get_mode(void);
+// output_message buffers one received message in the selected binary-safe format.
+// Buffered data is written out once the buffer fills up or OUTPUT_FLUSH_INTERVAL_MS elapses.
+int output_message(unsigned int prio, const char *data, size_t len);
+// output_flush writes all buffered data to standard output.
+int output_flush(void);
+// output_flush_deadline stores the CLOCK_REALTIME time at which pending data should be
+// flushed, or OUTPUT_FLUSH_INTERVAL_MS from now if nothing is pending.
+void output_flush_deadline(struct timespec *deadline);
+
+#define OUTPUT_FLUSH_INTERVAL_MS 100
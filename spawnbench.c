@@ -0,0 +1,98 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Zygmunt Krynicki
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+extern char **environ;
+
+// spawnbench measures the time between spawning a program and reaping it,
+// with standard output and standard error discarded. The exit status of the
+// program is ignored so that error paths can be measured as well.
+
+static int compare_ll(const void *a, const void *b)
+{
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+static long long elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+    return (long long)(end->tv_sec - start->tv_sec) * 1000000000LL + (end->tv_nsec - start->tv_nsec);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "usage: spawnbench ITERATIONS PROGRAM [ARGS...]\n");
+        return 1;
+    }
+
+    int iterations = atoi(argv[1]);
+    if (iterations <= 0)
+    {
+        fprintf(stderr, "number of iterations must be greater than zero\n");
+        return 1;
+    }
+
+    long long *samples = calloc(iterations, sizeof *samples);
+    if (samples == NULL)
+    {
+        perror("calloc");
+        return 1;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+    for (int i = 0; i < iterations; i++)
+    {
+        struct timespec start, end;
+        pid_t pid;
+        int status;
+
+        (void)clock_gettime(CLOCK_MONOTONIC, &start);
+        int err = posix_spawn(&pid, argv[2], &actions, NULL, argv + 2, environ);
+        if (err != 0)
+        {
+            fprintf(stderr, "cannot spawn %s: %s\n", argv[2], strerror(err));
+            free(samples);
+            return 1;
+        }
+        if (waitpid(pid, &status, 0) == -1)
+        {
+            perror("waitpid");
+            free(samples);
+            return 1;
+        }
+        (void)clock_gettime(CLOCK_MONOTONIC, &end);
+        samples[i] = elapsed_ns(&start, &end);
+    }
+
+    posix_spawn_file_actions_destroy(&actions);
+
+    long long sum = 0;
+    for (int i = 0; i < iterations; i++)
+        sum += samples[i];
+    qsort(samples, iterations, sizeof *samples, compare_ll);
+
+    // One line per command, suitable for tracking over time.
+    for (int i = 2; i < argc; i++)
+        printf("%s%s", i > 2 ? " " : "", argv[i]);
+    printf("\titerations=%d min_ns=%lld median_ns=%lld mean_ns=%lld max_ns=%lld\n", iterations, samples[0],
+           samples[iterations / 2], sum / iterations, samples[iterations - 1]);
+
+    free(samples);
+    return 0;
+}